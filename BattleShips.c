@@ -18,12 +18,39 @@ Purpose:
     At this point the leaderboard is displayed (if leaderboard.txt exists, if not it is created). If the player won they are asked
     if they wish to add their score to the leaderboard. After this the player is asked if they wish to play again. If yes, the program
     loops back to the beginning.
+
+    Campaign mode (BattleShips campaign <checkpoint_file> [games_per_difficulty] [workers] [seed]), POSIX systems only:
+    Plays the AI headlessly against randomly placed boards on every difficulty, spread across several worker processes.
+    Workers count the shots needed to sink every ship into per-difficulty histograms held in shared memory. The results of
+    each game are checkpointed to <checkpoint_file> periodically, so a killed campaign can be resumed by running the same
+    command again. Every game has its own seed, so the remaining games are replayed exactly as they would have been.
 */
 
+// Expose POSIX (sigaction, kill) and MAP_ANONYMOUS declarations used by campaign mode, even with strict -std=c99/c11
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <ctype.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+// Campaign mode needs POSIX processes and shared memory, so it is left out elsewhere (e.g. Windows)
+#if defined(__unix__) || defined(__APPLE__)
+#include <stdatomic.h>
+// Atomics that fall back to locks are only atomic within one process, so they can't be shared between workers
+#if ATOMIC_LONG_LOCK_FREE == 2 && ATOMIC_CHAR_LOCK_FREE == 2
+#define CAMPAIGN_SUPPORTED
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
+#endif
 
 // 'A': Aircraft Carrier (AAAAA)
 // 'B': Battleship (BBBB)
@@ -33,6 +60,12 @@ Purpose:
 #define SHIP_SET {'A', 'B', 'C', 'S', 'D'} // Customise amount of ships and order of placement
 #define NUM_OF_SHIPS 5 // Must match number of ships in SHIP_SET
 
+#define NUM_OF_DIFFICULTIES 3 // Number of values in enum game_difficulty
+#define MAX_SHOTS 100 // Most shots a game can take (one per position on the board)
+#define CHECKPOINT_INTERVAL 5 // Seconds between campaign checkpoints
+#define MAX_GAMES_PER_DIFFICULTY 100000000 // Limits the size of the campaign's shared memory and checkpoint file
+#define MAX_WORKERS 1024 // Most worker processes a campaign can start
+
 // Struct used to keep track of positions on the board.
 struct Coord{
     int x;
@@ -70,8 +103,26 @@ struct AiData{
     enum game_difficulty {easy, normal, hard} difficulty; // Gamemode decides the overall behavior of the AI
     int destroyMode; // 0: search mode, 1: destroy mode. AI is in search mode by default
     struct BoatSegment *lastSucHit; // pointer to last successfully hit BoatSegment
+    int is_headless; // 1: result of each move is not printed (used by campaign mode)
 };
 
+// Result of a campaign, used as the exit status of the program so scripts can tell if a campaign needs to be run again
+enum CampaignStatus{
+    campaign_complete, campaign_error, campaign_unfinished
+};
+
+#ifdef CAMPAIGN_SUPPORTED
+// Region of memory shared between the campaign's worker processes. Only updated using atomic operations so no locks are needed.
+struct CampaignShared{
+    long games_per_difficulty;
+    long total_games; // games_per_difficulty for each difficulty, game index / games_per_difficulty gives the difficulty
+    unsigned int seed; // Game index is added to this to give the seed of each game
+    atomic_long next_game; // Index of next game for a worker to claim
+    atomic_long histogram[NUM_OF_DIFFICULTIES][MAX_SHOTS+1]; // histogram[difficulty][shots]: Number of games won in that many shots
+    atomic_uchar results[]; // Shots taken in each game, 0 if the game has not been completed yet
+};
+#endif
+
 // Enum used throughout program to represent a cardinal direction on the board
 enum Direction{
     up, right, down, left
@@ -100,7 +151,31 @@ void playerMove(struct Board *);
 void writeToLeaderboard(int, char *);
 void displayLeaderboard();
 
-void main() {
+int simulateGame(enum game_difficulty, unsigned int);
+#ifdef CAMPAIGN_SUPPORTED
+enum CampaignStatus runCampaign(int, char *[]);
+void campaignWorker(struct CampaignShared *, pid_t);
+void writeCampaignCheckpoint(struct CampaignShared *, char *);
+struct CampaignShared * readCampaignCheckpoint(char *, int *);
+struct CampaignShared * createCampaignShared(long, unsigned int);
+void displayCampaignResults(struct CampaignShared *);
+long countCompletedGames(struct CampaignShared *);
+int parseCampaignNumber(char *, unsigned long, unsigned long, unsigned long *);
+void campaignSignalHandler(int);
+
+volatile sig_atomic_t campaign_stop_requested = 0; // Set when a campaign is interrupted (e.g Ctrl+C) so it can checkpoint and exit
+#endif
+
+int main(int argc, char *argv[]) {
+    if(argc > 1 && strcmp(argv[1], "campaign") == 0){ // Headless simulation campaign instead of an interactive game
+#ifdef CAMPAIGN_SUPPORTED
+        return runCampaign(argc-2, argv+2);
+#else
+        printf("Campaign mode is not supported on this platform\n");
+        return campaign_error;
+#endif
+    }
+
     srand(time(0)); // Seed pseudorandom number generator with current time
     int repeat = 1;
     while(repeat){ // CRITERIA 7: Program loops to start
@@ -114,6 +189,7 @@ void main() {
         struct Board player_board;
         struct Board ai_board;
         ai_data.destroyMode = 0; // AI initially set to search mode
+        ai_data.is_headless = 0;
 
         int valid; // Input validation boolean
         do{ // CRITERIA 2: Repitition
@@ -186,6 +262,7 @@ void main() {
         // CRITERIA 7: Program loops to start
         repeat = (tolower(response) == 'y'); // Sets repeat to true if player inputs Y or y, continuing the main while loop
     }
+    return 0;
 }
 
 
@@ -588,7 +665,9 @@ void aiMove(struct Board *player_board_ptr, struct AiData *ai_data_ptr){
         if(is_sunk){ai_data_ptr->destroyMode = 0;} // Return to search mode if this sunk the ship
     }
 
-    if(struck_ship_type == '-'){
+    if(ai_data_ptr->is_headless){
+        return;
+    }else if(struck_ship_type == '-'){
         printf("\nAI MISSED!\n\n");
     }else if(is_sunk){
         printf("\nThe AI SUNK your %s!\n\n", shipCharToName(struck_ship_type));
@@ -648,3 +727,304 @@ void displayLeaderboard(){
 
     fclose(file);
 }
+
+
+
+// Plays a single game headlessly with the AI striking a randomly placed board until all ships are sunk.
+// Returns the number of shots taken. The same difficulty and seed always give the same result.
+int simulateGame(enum game_difficulty difficulty, unsigned int seed){
+    srand(seed);
+    struct AiData ai_data;
+    ai_data.difficulty = difficulty;
+    ai_data.destroyMode = 0; // AI initially set to search mode
+    ai_data.is_headless = 1;
+
+    struct Board target_board;
+    initialiseBoard(&target_board, 0); // Automatically place ships for the AI to strike
+
+    int shots = 0;
+    while(target_board.score < NUM_OF_SHIPS){ // AI strikes until every ship is sunk
+        aiMove(&target_board, &ai_data);
+        shots++;
+    }
+    return shots;
+}
+
+#ifdef CAMPAIGN_SUPPORTED
+// Runs a simulation campaign using the arguments after "campaign": <checkpoint_file> [games_per_difficulty] [workers] [seed].
+// If the checkpoint file already exists the campaign is resumed from it, using its games_per_difficulty and seed instead.
+// Returns campaign_unfinished if the campaign was interrupted or games were left unplayed, so it should be run again.
+enum CampaignStatus runCampaign(int argc, char *argv[]){
+    if(argc < 1){
+        printf("Usage: BattleShips campaign <checkpoint_file> [games_per_difficulty] [workers] [seed]\n");
+        return campaign_error;
+    }
+    char *checkpoint_path = argv[0];
+    if(strlen(checkpoint_path) + strlen(".tmp") >= FILENAME_MAX){ // Room is needed for the temporary checkpoint path
+        printf("Error: Checkpoint file path is too long\n");
+        return campaign_error;
+    }
+    unsigned long value;
+    // games_per_difficulty and seed are only needed (so only have to be valid) when starting a new campaign
+    long games_per_difficulty = 10000;
+    int is_games_valid = 1;
+    if(argc > 1){
+        is_games_valid = parseCampaignNumber(argv[1], 1, MAX_GAMES_PER_DIFFICULTY, &value);
+        games_per_difficulty = value;
+    }
+    unsigned int seed = (unsigned int)time(0);
+    int is_seed_valid = 1;
+    if(argc > 3){
+        is_seed_valid = parseCampaignNumber(argv[3], 0, UINT_MAX, &value);
+        seed = value;
+    }
+    int num_workers = 4;
+    if(argc > 2){
+        if(!parseCampaignNumber(argv[2], 1, MAX_WORKERS, &value)){
+            printf("Error: workers must be a number from 1 to %d\n", MAX_WORKERS);
+            return campaign_error;
+        }
+        num_workers = value;
+    }
+
+    int is_invalid;
+    struct CampaignShared *shared = readCampaignCheckpoint(checkpoint_path, &is_invalid);
+    if(is_invalid){ // Never start a new campaign that would overwrite a file that isn't a checkpoint
+        printf("Campaign not started so %s is not overwritten\n", checkpoint_path);
+        return campaign_error;
+    }else if(shared){
+        printf("Resuming campaign from %s\n", checkpoint_path);
+        // Only warn about values that were actually given on the command line
+        if((argc > 1 && (!is_games_valid || games_per_difficulty != shared->games_per_difficulty))
+                || (argc > 3 && (!is_seed_valid || seed != shared->seed))){
+            printf("Warning: games_per_difficulty and seed given differ from the checkpoint, the checkpoint's values are used\n");
+        }
+    }else if(!is_games_valid){
+        printf("Error: games_per_difficulty must be a number from 1 to %d\n", MAX_GAMES_PER_DIFFICULTY);
+        return campaign_error;
+    }else if(!is_seed_valid){
+        printf("Error: seed must be a number from 0 to %u\n", UINT_MAX);
+        return campaign_error;
+    }else if(!(shared = createCampaignShared(games_per_difficulty, seed))){
+        return campaign_error;
+    }
+    printf("Campaign: %ld games per difficulty, seed %u, %d workers\n", shared->games_per_difficulty, shared->seed, num_workers);
+
+    // Stop workers after their current game and checkpoint when interrupted. Workers inherit this handler when forked.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = campaignSignalHandler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    fflush(stdout); // Flush before forking so buffered output is not duplicated by the workers
+    pid_t parent_pid = getpid();
+    pid_t *worker_pids = malloc(num_workers * sizeof(pid_t)); // 0 once the worker has been reaped
+    int num_started = 0; // Number of workers successfully forked, only the first num_started worker_pids are set
+    for(int i=0; i<num_workers; i++){
+        pid_t pid = fork();
+        if(pid == 0){
+            campaignWorker(shared, parent_pid); // Never returns
+        }else if(pid < 0){
+            printf("Error: Could not start worker %d\n", i);
+        }else{
+            worker_pids[num_started++] = pid;
+        }
+    }
+
+    int running = num_started; // Number of workers still running
+    int seconds = 0;
+    while(running > 0){
+        sleep(1); // Returns early if a signal is caught
+        pid_t finished_pid;
+        while((finished_pid = waitpid(-1, NULL, WNOHANG)) > 0){ // Collect finished workers
+            for(int i=0; i<num_started; i++){ // Mark as reaped so its (possibly reused) pid is never signalled
+                if(worker_pids[i] == finished_pid){worker_pids[i] = 0;}
+            }
+            running--;
+        }
+        if(campaign_stop_requested){
+            for(int i=0; i<num_started; i++){ // Make sure workers also stop if only this process was signalled
+                if(worker_pids[i] > 0){kill(worker_pids[i], SIGTERM);}
+            }
+            while(running > 0 && wait(NULL) > 0){
+                running--;
+            }
+        }else if(++seconds % CHECKPOINT_INTERVAL == 0 && running > 0){
+            writeCampaignCheckpoint(shared, checkpoint_path);
+        }
+    }
+    free(worker_pids);
+
+    writeCampaignCheckpoint(shared, checkpoint_path);
+    enum CampaignStatus status = campaign_unfinished;
+    if(campaign_stop_requested){
+        printf("Campaign interrupted, run the same command again to resume from %s\n", checkpoint_path);
+    }else if(countCompletedGames(shared) < shared->total_games){ // A worker died or could not be started, leaving games unplayed
+        printf("Campaign incomplete, run the same command again to resume from %s\n", checkpoint_path);
+    }else{
+        displayCampaignResults(shared);
+        status = campaign_complete;
+    }
+    munmap(shared, sizeof(struct CampaignShared) + shared->total_games);
+    return status;
+}
+
+// Worker process loop. Claims games from the shared counter, plays them, and records the results until none are left.
+// Also stops if the parent process dies, as nothing would be left to checkpoint the results.
+void campaignWorker(struct CampaignShared *shared, pid_t parent_pid){
+    long game;
+    while(!campaign_stop_requested && getppid() == parent_pid && (game = atomic_fetch_add(&shared->next_game, 1)) < shared->total_games){
+        if(atomic_load(&shared->results[game])){continue;} // Already completed before the campaign was resumed
+
+        int difficulty = game / shared->games_per_difficulty;
+        int shots = simulateGame(difficulty, shared->seed + (unsigned int)game);
+        atomic_fetch_add(&shared->histogram[difficulty][shots], 1);
+        atomic_store(&shared->results[game], shots); // Game only counts as completed once its result is stored
+    }
+    _exit(0);
+}
+
+// Writes the result of every game to the checkpoint file. Written to a temporary file first and then renamed over the old
+// checkpoint so a campaign killed during a write still has a complete checkpoint to resume from.
+// Histograms are not saved as they are rebuilt from the results, so a checkpoint is always consistent.
+void writeCampaignCheckpoint(struct CampaignShared *shared, char *checkpoint_path){
+    char temp_path[FILENAME_MAX];
+    int temp_path_length = snprintf(temp_path, sizeof(temp_path), "%s.tmp", checkpoint_path);
+    if(temp_path_length < 0 || temp_path_length >= (int)sizeof(temp_path)){ // A truncated path could be the checkpoint itself
+        printf("Error: Checkpoint file path is too long, could not write campaign checkpoint\n");
+        return;
+    }
+
+    FILE *file;
+    if(!(file = fopen(temp_path, "w"))){
+        printf("Error opening/creating file: Could not write campaign checkpoint\n");
+        return;
+    }
+
+    fprintf(file, "%ld %u\n", shared->games_per_difficulty, shared->seed);
+    for(long game = 0; game < shared->total_games; game++){
+        fprintf(file, "%d\n", atomic_load(&shared->results[game]));
+    }
+
+    if(fclose(file) != 0 || rename(temp_path, checkpoint_path) != 0){
+        printf("Error: Could not save campaign checkpoint\n");
+        return;
+    }
+    printf("Checkpoint: %ld/%ld games complete\n", countCompletedGames(shared), shared->total_games);
+    fflush(stdout); // Keep progress visible when output is redirected to a log file
+}
+
+// Reads a checkpoint file written by writeCampaignCheckpoint() into a new shared region, rebuilding the histograms.
+// Returns NULL if the checkpoint could not be read. is_invalid flag is set to false only if this is because the file does not exist.
+struct CampaignShared * readCampaignCheckpoint(char *checkpoint_path, int *is_invalid_ptr){
+    *is_invalid_ptr = 1; // Start with assumption that the file is invalid, only cleared once it is fully read or found not to exist
+    FILE *file;
+    if(!(file = fopen(checkpoint_path, "r"))){
+        if(errno == ENOENT){
+            *is_invalid_ptr = 0;
+        }else{
+            printf("Error: Could not open campaign checkpoint %s\n", checkpoint_path);
+        }
+        return NULL;
+    }
+
+    char games_str[32];
+    char seed_str[32];
+    unsigned long games_per_difficulty;
+    unsigned long seed;
+    struct CampaignShared *shared = NULL;
+    if(fscanf(file, "%31s %31s", games_str, seed_str) != 2
+            || !parseCampaignNumber(games_str, 1, MAX_GAMES_PER_DIFFICULTY, &games_per_difficulty)
+            || !parseCampaignNumber(seed_str, 0, UINT_MAX, &seed)
+            || !(shared = createCampaignShared(games_per_difficulty, seed))){
+        printf("Error: %s is not a valid campaign checkpoint\n", checkpoint_path);
+        fclose(file);
+        return NULL;
+    }
+
+    for(long game = 0; game < shared->total_games; game++){
+        int shots;
+        if(fscanf(file, "%d", &shots) != 1 || shots < 0 || shots > MAX_SHOTS){
+            printf("Error: %s is not a valid campaign checkpoint\n", checkpoint_path);
+            munmap(shared, sizeof(struct CampaignShared) + shared->total_games);
+            fclose(file);
+            return NULL;
+        }
+        if(shots){
+            atomic_store(&shared->results[game], shots);
+            atomic_fetch_add(&shared->histogram[game / shared->games_per_difficulty][shots], 1);
+        }
+    }
+
+    fclose(file);
+    *is_invalid_ptr = 0;
+    return shared;
+}
+
+// Maps a zeroed region of memory that is shared with forked worker processes, big enough for every game's result.
+struct CampaignShared * createCampaignShared(long games_per_difficulty, unsigned int seed){
+    long total_games = games_per_difficulty * NUM_OF_DIFFICULTIES;
+    struct CampaignShared *shared = mmap(NULL, sizeof(struct CampaignShared) + total_games,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(shared == MAP_FAILED){
+        printf("Error: Could not allocate shared memory for campaign\n");
+        return NULL;
+    }
+    shared->games_per_difficulty = games_per_difficulty;
+    shared->total_games = total_games;
+    shared->seed = seed;
+    atomic_init(&shared->next_game, 0);
+    return shared;
+}
+
+// Displays the average, best and worst number of shots taken by the AI on each difficulty followed by the histogram
+void displayCampaignResults(struct CampaignShared *shared){
+    char *difficulty_strs[NUM_OF_DIFFICULTIES] = {"easy", "normal", "hard"};
+    for(int difficulty = 0; difficulty < NUM_OF_DIFFICULTIES; difficulty++){
+        long games = 0;
+        long total_shots = 0;
+        int min_shots = 0;
+        int max_shots = 0;
+        for(int shots = 1; shots <= MAX_SHOTS; shots++){
+            long count = atomic_load(&shared->histogram[difficulty][shots]);
+            if(count){
+                if(!min_shots){min_shots = shots;}
+                max_shots = shots;
+            }
+            games += count;
+            total_shots += count * shots;
+        }
+        printf("\nAI on %s difficulty: %ld games, average %.2f shots (best %d, worst %d)\n",
+                difficulty_strs[difficulty], games, games ? (double)total_shots / games : 0.0, min_shots, max_shots);
+        for(int shots = min_shots; shots <= max_shots && games; shots++){
+            printf("%3d shots: %ld\n", shots, (long)atomic_load(&shared->histogram[difficulty][shots]));
+        }
+    }
+}
+
+// Counts the games that have a result stored, i.e. that have been completed
+long countCompletedGames(struct CampaignShared *shared){
+    long completed = 0;
+    for(long game = 0; game < shared->total_games; game++){
+        completed += (atomic_load(&shared->results[game]) != 0);
+    }
+    return completed;
+}
+
+// Converts a whole decimal number string to an unsigned long. Returns false if it isn't entirely a number from min to max.
+int parseCampaignNumber(char *str, unsigned long min, unsigned long max, unsigned long *value_ptr){
+    if(!isdigit((unsigned char)str[0])){return 0;} // strtoul would otherwise accept leading spaces and negative numbers
+    char *end_ptr;
+    errno = 0;
+    *value_ptr = strtoul(str, &end_ptr, 10);
+    return errno == 0 && *end_ptr == '\0' && *value_ptr >= min && *value_ptr <= max;
+}
+
+// Requests the campaign to stop. Only sets a flag as it is called from a signal handler.
+void campaignSignalHandler(int signal_number){
+    (void)signal_number; // Same handler is used for every signal
+    campaign_stop_requested = 1;
+}
+#endif